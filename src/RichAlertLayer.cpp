@@ -1,4 +1,8 @@
 #include "RichAlertLayer.hpp"
+#include <Geode/modify/AppDelegate.hpp>
+
+#include <charconv>
+#include <chrono>
 
 RichAlertLayer* RichAlertLayer::create(std::string const& title, std::string const& richText, std::string const& btn1, std::string const& btn2,
     float width, bool scroll, float height, float textScale) {
@@ -11,6 +15,56 @@ RichAlertLayer* RichAlertLayer::create(std::string const& title, std::string con
     return nullptr;
 }
 
+RichAlertLayer* RichAlertLayer::createCached(std::string const& title, std::string const& richText, std::string const& btn1, std::string const& btn2,
+    float width, bool scroll, float height, float textScale) {
+    auto ret = new RichAlertLayer();
+    if (ret) {
+        ret->m_cacheTexture = true;
+        if (ret->init(title, richText, btn1, btn2, width, scroll, height, textScale)) {
+            ret->autorelease();
+            return ret;
+        }
+    }
+    CC_SAFE_DELETE(ret);
+    return nullptr;
+}
+
+RichAlertLayer* RichAlertLayer::createSliced(std::string const& title, std::string const& richText, std::string const& btn1, std::string const& btn2,
+    float width, bool scroll, float height, float textScale) {
+    auto ret = new RichAlertLayer();
+    if (ret) {
+        ret->m_sliced = true;
+        if (ret->init(title, richText, btn1, btn2, width, scroll, height, textScale)) {
+            ret->autorelease();
+            return ret;
+        }
+    }
+    CC_SAFE_DELETE(ret);
+    return nullptr;
+}
+
+void RichAlertLayer::clearTextCache() {
+    s_bakedTexts.clear();
+}
+
+void RichAlertLayer::setTextCacheLimit(size_t count) {
+    s_textCacheLimit = count;
+    trimTextCache();
+}
+
+void RichAlertLayer::trimTextCache() {
+    while (s_bakedTexts.size() > s_textCacheLimit) {
+        auto oldest = std::min_element(s_bakedTexts.begin(), s_bakedTexts.end(),
+            [](auto const& a, auto const& b) { return a.second.lastUse < b.second.lastUse; });
+        s_bakedTexts.erase(oldest);
+    }
+}
+
+void RichAlertLayer::setFastPathThresholds(size_t maxGlyphs, size_t maxSpans) {
+    s_fastPathGlyphs = maxGlyphs;
+    s_fastPathSpans = maxSpans;
+}
+
 void RichAlertLayer::show() {
     CCDirector::sharedDirector()->getRunningScene()->addChild(this);
 }
@@ -18,12 +72,26 @@ void RichAlertLayer::show() {
 bool RichAlertLayer::init(std::string const& p1, std::string const& p2, std::string const& p3, std::string const& p4,
     float p5, bool p6, float p7, float p8) {
 
-    auto parsed = parseRichText(p2);
+    std::string cacheKey;
+    BakedText* baked = nullptr;
+    if (m_cacheTexture) {
+        // the whole key is compared, so two bodies can never share a texture
+        cacheKey = fmt::format("{}|{}|{}|{}|{}", p5, p6, p7, p8, p2);
+        if (auto it = s_bakedTexts.find(cacheKey); it != s_bakedTexts.end()) {
+            baked = &it->second;
+            baked->lastUse = ++s_bakeClock;
+        }
+    }
+
+    // a cached body already knows its plain text, so parsing can be skipped
+    ParsedText parsed;
+    if (!baked) parsed = parseRichText(p2);
+    auto const& text = baked ? baked->text : parsed.text;
 
     if (!FLAlertLayer::init(
         nullptr,
         p1.c_str(),
-        parsed.text.c_str(),
+        text.c_str(),
         p3.c_str(),
         p4.empty() ? nullptr : p4.c_str(),
         p5, p6, p7, p8))
@@ -35,15 +103,194 @@ bool RichAlertLayer::init(std::string const& p1, std::string const& p2, std::str
     auto mbf = textArea->getChildByType<MultilineBitmapFont>(0);
     if (!mbf) return true;
 
-    applyFontStyleTags(mbf, parsed.boldTags, parsed.italicTags);
-    applyLinkTags(mbf, parsed.links);
-    applyColorTags(mbf, parsed.colors);
-    applyUnderlineTags(mbf, parsed.underlines);
-    applyStrikeTags(mbf, parsed.strikeTags);
+    if (baked) {
+        useBakedText(mbf, *baked);
+        return true;
+    }
+
+    m_buildJob = std::make_unique<BuildJob>();
+    auto& job = *m_buildJob;
+    job.parsed = std::move(parsed);
+    job.mbf = mbf;
+    job.cacheKey = std::move(cacheKey);
+
+    size_t spanCount = job.parsed.colors.size() + job.parsed.underlines.size() + job.parsed.boldTags.size()
+        + job.parsed.italicTags.size() + job.parsed.strikeTags.size() + job.parsed.links.size();
+    for (auto const& tags : job.parsed.customTags)
+        spanCount += tags.size();
+
+    if (job.parsed.glyphCount > s_fastPathGlyphs || spanCount > s_fastPathSpans) {
+        m_renderPath = RenderPath::Fast;
+        ++s_fastPathCount;
+        log::debug("Using fast path for {} glyphs and {} spans", job.parsed.glyphCount, spanCount);
+        job.colorMap = buildColorMap(job.parsed);
+    }
+
+    job.lines = collectLines(mbf);
+    job.fontTier = pickFontTier(mbf->nodeToWorldTransform().a);
+
+    if (m_sliced) {
+        this->schedule(schedule_selector(RichAlertLayer::updateBuild));
+        return true;
+    }
+
+    while (buildStep(job)) {}
+    finishBuild();
 
     return true;
 }
 
+// Runs one resumable unit of styling work: a line of the style relayout, a
+// label of the glyph collection, or a single span of the built-in passes. A
+// custom tag's render pass gets all its spans at once, so each custom tag is
+// one step however many spans it has. Returns false once everything is done.
+bool RichAlertLayer::buildStep(BuildJob& job) {
+    auto const& parsed = job.parsed;
+    bool fast = m_renderPath == RenderPath::Fast;
+
+    switch (job.stage) {
+    case BuildStage::Relayout:
+        if (job.cursor < job.lines.size()) {
+            relayoutLine(job, job.cursor++);
+            return true;
+        }
+        break;
+
+    case BuildStage::Glyphs:
+        if (job.cursor == 0) {
+            job.glyphs.assign(parsed.glyphCount, nullptr);
+            job.glyphOffset = 0;
+        }
+        if (auto children = job.mbf->getChildren(); children && job.cursor < children->count()) {
+            if (auto label = typeinfo_cast<CCLabelBMFont*>(children->objectAtIndex(job.cursor++))) {
+                size_t start = job.glyphOffset;
+                size_t count = buildGlyphIndex(label->getString()).back();
+                job.glyphOffset += count;
+                if (job.glyphOffset > job.glyphs.size()) job.glyphs.resize(job.glyphOffset, nullptr);
+
+                // characters missing from the font get no sprite, so every sprite is placed
+                // by its tag, the index of its character in the label, leaving a hole instead
+                for (auto glyph : CCArrayExt<CCFontSprite*>(label->getChildren())) {
+                    auto tag = glyph->getTag();
+                    if (tag >= 0 && static_cast<size_t>(tag) < count)
+                        job.glyphs[start + tag] = glyph;
+                }
+            }
+            return true;
+        }
+
+        if (job.glyphOffset != parsed.glyphCount)
+            log::warn("Rendered {} glyphs but parsed {}, spans may be offset", job.glyphOffset, parsed.glyphCount);
+
+        m_revealGlyphs.assign(job.glyphs.begin(), job.glyphs.end());
+        job.linkLayer = replaceLayer(job.mbf, "linkLayer");
+        job.underlineLayer = replaceLayer(job.mbf, "underlineLayer");
+        job.strikeLayer = replaceLayer(job.mbf, "strikelineLayer");
+        break;
+
+    case BuildStage::Links:
+        if (job.cursor < parsed.links.size()) {
+            applyLinkTag(job.linkLayer, job.glyphs, parsed.links[job.cursor++], job.linkSegments);
+            return true;
+        }
+        m_linkArea = job.mbf;
+        m_linkSegments = std::move(job.linkSegments);
+        m_linkIndex.build(m_linkSegments);
+        break;
+
+    case BuildStage::Colors:
+        if (!fast && job.cursor < parsed.colors.size()) {
+            applyColorTag(job.glyphs, parsed.colors[job.cursor++]);
+            return true;
+        }
+        break;
+
+    case BuildStage::Underlines:
+        if (job.cursor < parsed.underlines.size()) {
+            applyUnderlineTag(job.underlineLayer, job.glyphs, parsed.underlines[job.cursor++]);
+            return true;
+        }
+        break;
+
+    case BuildStage::Strikes:
+        if (job.cursor < parsed.strikeTags.size()) {
+            applyStrikeTag(job.strikeLayer, job.glyphs, parsed.strikeTags[job.cursor++]);
+            return true;
+        }
+        break;
+
+    case BuildStage::Custom:
+        while (job.cursor < parsed.customTags.size() && parsed.customTags[job.cursor].empty())
+            ++job.cursor;
+        if (job.cursor < parsed.customTags.size()) {
+            applyCustomTags(job.mbf, job.glyphs, job.cursor, parsed.customTags[job.cursor]);
+            ++job.cursor;
+            return true;
+        }
+        break;
+
+    case BuildStage::Done:
+        return false;
+    }
+
+    job.stage = static_cast<BuildStage>(static_cast<int>(job.stage) + 1);
+    job.cursor = 0;
+    return true;
+}
+
+void RichAlertLayer::updateBuild(float dt) {
+    if (!m_buildJob) return;
+
+    auto start = std::chrono::steady_clock::now();
+    auto budget = std::chrono::duration<float>(m_frameBudget);
+
+    // checked after each step, so every frame makes progress even if a
+    // single step is longer than the whole budget
+    while (buildStep(*m_buildJob)) {
+        if (std::chrono::steady_clock::now() - start >= budget) return;
+    }
+
+    this->unschedule(schedule_selector(RichAlertLayer::updateBuild));
+    finishBuild();
+}
+
+void RichAlertLayer::finishBuild() {
+    auto job = std::move(m_buildJob);
+
+    if (m_cacheTexture) {
+        BakedText fresh;
+        fresh.text = job->parsed.text;
+        if (bakeTextArea(job->mbf, fresh)) {
+            useBakedText(job->mbf, fresh);
+            fresh.lastUse = ++s_bakeClock;
+            s_bakedTexts.insert_or_assign(std::move(job->cacheKey), std::move(fresh));
+            trimTextCache();
+        }
+    }
+
+    if (m_revealPending) {
+        m_revealPending = false;
+        startReveal(m_revealSpeed, std::move(m_onRevealComplete));
+    }
+
+    if (auto onComplete = std::move(m_onBuildComplete)) {
+        m_onBuildComplete = nullptr;
+        onComplete();
+    }
+}
+
+void RichAlertLayer::setFrameBudget(float seconds) {
+    m_frameBudget = seconds;
+}
+
+void RichAlertLayer::setOnBuildComplete(std::function<void()> onComplete) {
+    if (!m_buildJob) {
+        if (onComplete) onComplete();
+        return;
+    }
+    m_onBuildComplete = std::move(onComplete);
+}
+
 struct ColorTag {
     size_t start;
     size_t end;
@@ -72,251 +319,266 @@ struct StrikeTag {
     size_t end;
 };
 
+bool RichAlertLayer::parseHexColor(std::string_view hex, ccColor3B& out) {
+    if (!hex.empty() && hex[0] == '#') hex.remove_prefix(1);
+    if (hex.size() != 6) return false;
+
+    auto hexToByte = [](std::string_view h) -> GLubyte {
+        unsigned value = 0;
+        std::from_chars(h.data(), h.data() + h.size(), value, 16);
+        return static_cast<GLubyte>(value);
+        };
+    out = {
+        hexToByte(hex.substr(0, 2)),
+        hexToByte(hex.substr(2, 2)),
+        hexToByte(hex.substr(4, 2))
+    };
+    return true;
+}
+
 RichAlertLayer::ParsedText RichAlertLayer::parseRichText(std::string const& raw) {
+    auto& registry = RichTagRegistry::get();
+    std::string_view input = raw;
+
     ParsedText result;
-    size_t pos = 0;
+    result.customTags.resize(registry.size() - RichTagRegistry::BuiltinCount);
 
-    std::vector<std::pair<size_t, ccColor3B>> colorStack;
-    std::vector<size_t> underlineStack;
-    std::vector<size_t> boldStack;
-    std::vector<size_t> italicStack;
-    std::vector<size_t> strikeStack;
-    std::vector<std::pair<size_t, std::string>> linkStack;
-
-    while (pos < raw.size()) {
-        if (raw[pos] == '<') {
-            size_t tagEnd = raw.find('>', pos);
-            if (tagEnd == std::string::npos) break;
-
-            std::string tag = raw.substr(pos + 1, tagEnd - pos - 1);
-
-            if (tag.starts_with("col=")) {
-                std::string hex = tag.substr(4);
-                if (!hex.empty() && hex[0] == '#') hex.erase(0, 1);
-
-                if (hex.size() == 6) {
-                    auto hexToByte = [](const std::string& h) -> GLubyte {
-                        return static_cast<GLubyte>(std::strtoul(h.c_str(), nullptr, 16));
-                        };
-                    ccColor3B col = {
-                        hexToByte(hex.substr(0, 2)),
-                        hexToByte(hex.substr(2, 2)),
-                        hexToByte(hex.substr(4, 2))
-                    };
-                    colorStack.emplace_back(result.text.length(), col);
-                }
+    // open spans per tag id, holding their start offset and argument
+    std::vector<std::vector<std::pair<size_t, std::string_view>>> stacks(registry.size());
 
-                pos = tagEnd + 1;
-                continue;
-            }
+    // returns false if the tag should be kept as literal text
+    auto handleTag = [&](std::string_view tag) -> bool {
+        bool closing = tag.starts_with('/');
+        if (closing) tag.remove_prefix(1);
 
-            if (tag == "/col") {
-                if (!colorStack.empty()) {
-                    auto [start, col] = colorStack.back();
-                    colorStack.pop_back();
-                    result.colors.push_back(ColorTag{ start, result.text.length(), col });
-                }
-                pos = tagEnd + 1;
-                continue;
-            }
+        size_t eq = tag.find('=');
+        bool hasArg = eq != std::string_view::npos;
+        auto arg = hasArg ? tag.substr(eq + 1) : std::string_view{};
 
-            if (tag == "u") {
-                underlineStack.push_back(result.text.length());
-                pos = tagEnd + 1;
-                continue;
-            }
+        auto id = registry.find(tag.substr(0, eq));
+        if (id == RichTagRegistry::npos) return false;
 
-            if (tag == "/u") {
-                if (!underlineStack.empty()) {
-                    size_t start = underlineStack.back();
-                    underlineStack.pop_back();
-                    result.underlines.push_back(UnderlineTag{ start, result.text.length() });
-                }
-                pos = tagEnd + 1;
-                continue;
-            }
+        if (closing) {
+            if (hasArg) return false;
+            // a custom tag whose onOpen declined stays literal, so its closing tag does too
+            if (stacks[id].empty()) return id < RichTagRegistry::BuiltinCount;
 
-            if (tag == "b") {
-                boldStack.push_back(result.text.length());
-                pos = tagEnd + 1;
-                continue;
-            }
+            auto [start, open] = stacks[id].back();
+            stacks[id].pop_back();
+            size_t end = result.text.length();
 
-            if (tag == "/b") {
-                if (!boldStack.empty()) {
-                    size_t start = boldStack.back();
-                    boldStack.pop_back();
-                    result.boldTags.push_back(BoldTag{ start, result.text.length() });
-                }
-                pos = tagEnd + 1;
-                continue;
+            switch (id) {
+            case RichTagRegistry::Color: {
+                ccColor3B col;
+                parseHexColor(open, col);
+                result.colors.push_back(ColorTag{ start, end, col });
+                break;
             }
-
-            if (tag == "i") {
-                italicStack.push_back(result.text.length());
-                pos = tagEnd + 1;
-                continue;
+            case RichTagRegistry::Underline:
+                result.underlines.push_back(UnderlineTag{ start, end });
+                break;
+            case RichTagRegistry::Bold:
+                result.boldTags.push_back(BoldTag{ start, end });
+                break;
+            case RichTagRegistry::Italic:
+                result.italicTags.push_back(ItalicTag{ start, end });
+                break;
+            case RichTagRegistry::Strike:
+                result.strikeTags.push_back(StrikeTag{ start, end });
+                break;
+            case RichTagRegistry::Link:
+                result.links.push_back(LinkTag{ start, end, std::string(open) });
+                break;
+            default: {
+                RichTag custom{ start, end, std::string(open) };
+                if (auto& onClose = registry.handlers(id).onClose)
+                    onClose(custom, result.text);
+                result.customTags[id - RichTagRegistry::BuiltinCount].push_back(std::move(custom));
+                break;
             }
-
-            if (tag == "/i") {
-                if (!italicStack.empty()) {
-                    size_t start = italicStack.back();
-                    italicStack.pop_back();
-                    result.italicTags.push_back(ItalicTag{ start, result.text.length() });
-                }
-                pos = tagEnd + 1;
-                continue;
             }
+            return true;
+        }
 
-            if (tag == "s") {
-                strikeStack.push_back(result.text.length());
-                pos = tagEnd + 1;
-                continue;
-            }
+        size_t start = result.text.length();
 
-            if (tag == "/s") {
-                if (!strikeStack.empty()) {
-                    size_t start = strikeStack.back();
-                    strikeStack.pop_back();
-                    result.strikeTags.push_back(StrikeTag{ start, result.text.length() });
-                }
-                pos = tagEnd + 1;
-                continue;
-            }
+        switch (id) {
+        case RichTagRegistry::Color: {
+            ccColor3B col;
+            if (!hasArg) return false;
+            if (!parseHexColor(arg, col)) return true;
+            break;
+        }
+        case RichTagRegistry::Link:
+            if (!hasArg) return false;
+            break;
+        case RichTagRegistry::Underline:
+        case RichTagRegistry::Bold:
+        case RichTagRegistry::Italic:
+        case RichTagRegistry::Strike:
+            if (hasArg) return false;
+            break;
+        default:
+            if (auto& onOpen = registry.handlers(id).onOpen; onOpen && !onOpen(arg, result.text))
+                return false;
+            break;
+        }
 
-            if (tag.starts_with("link=")) {
-                std::string url = tag.substr(5);
-                linkStack.emplace_back(result.text.length(), url);
-                pos = tagEnd + 1;
-                continue;
-            }
+        stacks[id].emplace_back(start, arg);
+        return true;
+    };
 
-            if (tag == "/link") {
-                if (!linkStack.empty()) {
-                    auto [start, url] = linkStack.back();
-                    linkStack.pop_back();
-                    result.links.push_back(LinkTag{ start, result.text.length(), url });
-                }
-                pos = tagEnd + 1;
-                continue;
-            }
+    size_t pos = 0;
+    while (pos < input.size()) {
+        size_t tagStart = input.find('<', pos);
+        if (tagStart == std::string_view::npos) {
+            result.text += input.substr(pos);
+            break;
+        }
+        result.text += input.substr(pos, tagStart - pos);
+
+        size_t tagEnd = input.find('>', tagStart);
+        if (tagEnd == std::string_view::npos) break;
+
+        if (!handleTag(input.substr(tagStart + 1, tagEnd - tagStart - 1)))
+            result.text += input.substr(tagStart, tagEnd - tagStart + 1);
+        pos = tagEnd + 1;
+    }
+
+    remapToGlyphs(result);
+    return result;
+}
 
-            result.text += raw.substr(pos, tagEnd - pos + 1);
-            pos = tagEnd + 1;
+// Length of the game's own text tag at pos, or 0 if there is none. These are
+// left in the text as literal tags and MultilineBitmapFont strips them, so
+// "<cr>", "</c>", "<d050>" and "<s100>" never become glyphs.
+static size_t gameTagLength(std::string_view text, size_t pos) {
+    auto rest = text.substr(pos);
+    if (rest.size() < 4 || rest[0] != '<') return 0;
+
+    if (rest.starts_with("</c>")) return 4;
+    if (rest[1] == 'c' && rest[2] != '>' && rest[3] == '>') return 4;
+
+    if (rest[1] == 'd' || rest[1] == 's') {
+        size_t end = 2;
+        while (end < rest.size() && rest[end] >= '0' && rest[end] <= '9')
+            ++end;
+        if (end > 2 && end < rest.size() && rest[end] == '>') return end + 1;
+    }
+    return 0;
+}
+
+// Maps every byte of the text to the index of the glyph it is drawn with. The
+// extra trailing entry holds the total glyph count, so span ends map cleanly.
+// UTF-8 continuation bytes share the glyph of their lead byte, and newlines
+// and the game's own tags don't produce a glyph since MultilineBitmapFont
+// consumes them.
+std::vector<size_t> RichAlertLayer::buildGlyphIndex(std::string_view text) {
+    std::vector<size_t> index(text.size() + 1);
+    size_t glyph = 0;
+    size_t i = 0;
+
+    while (i < text.size()) {
+        while (i < text.size() && static_cast<unsigned char>(text[i]) < 0x80 && text[i] != '\n' && text[i] != '<')
+            index[i++] = glyph++;
+
+        if (i >= text.size()) break;
+
+        auto lead = static_cast<unsigned char>(text[i]);
+        if (lead == '\n') {
+            index[i++] = glyph;
+            continue;
         }
-        else {
-            result.text += raw[pos];
-            ++pos;
+        if (lead == '<') {
+            size_t len = std::max<size_t>(gameTagLength(text, i), 1);
+            for (size_t k = 0; k < len; ++k)
+                index[i++] = glyph;
+            if (len == 1) ++glyph;
+            continue;
         }
+
+        size_t len = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+        for (size_t k = 0; k < len && i < text.size(); ++k)
+            index[i++] = glyph;
+        ++glyph;
     }
 
-    return result;
+    index[text.size()] = glyph;
+    return index;
 }
 
+void RichAlertLayer::remapToGlyphs(ParsedText& parsed) {
+    auto index = buildGlyphIndex(parsed.text);
+    auto remap = [&](auto& tags) {
+        for (auto& tag : tags) {
+            tag.start = index[tag.start];
+            tag.end = index[tag.end];
+        }
+    };
 
+    remap(parsed.colors);
+    remap(parsed.underlines);
+    remap(parsed.boldTags);
+    remap(parsed.italicTags);
+    remap(parsed.strikeTags);
+    remap(parsed.links);
+    for (auto& tags : parsed.customTags)
+        remap(tags);
+    parsed.glyphCount = index.back();
+}
 
+// Packs the color of every glyph into one value per glyph for the fast path,
+// which colors whole label runs instead of single glyphs. Links are written
+// last so they keep their color, like the link clones on the full path.
+std::vector<uint32_t> RichAlertLayer::buildColorMap(ParsedText const& parsed) {
+    std::vector<uint32_t> map(parsed.glyphCount, NoColor);
+    auto fill = [&](size_t start, size_t end, ccColor3B col) {
+        uint32_t packed = (col.r << 16) | (col.g << 8) | col.b;
+        for (size_t i = start; i < end && i < map.size(); ++i)
+            map[i] = packed;
+    };
 
-void RichAlertLayer::applyColorTags(MultilineBitmapFont* mbf, std::vector<ColorTag> const& tags) {
-    for (const auto& tag : tags) {
-        size_t globalIndex = 0;
+    for (auto const& tag : parsed.colors)
+        fill(tag.start, tag.end, tag.color);
+    for (auto const& tag : parsed.links)
+        fill(tag.start, tag.end, ccc3(0, 255, 255));
 
-        for (auto label : CCArrayExt<CCLabelBMFont*>(mbf->getChildren())) {
-            if (!label) continue;
+    return map;
+}
 
-            auto glyphs = CCArrayExt<CCFontSprite*>(label->getChildren());
-            for (auto glyph : glyphs) {
-                if (globalIndex >= tag.start && globalIndex < tag.end) {
-                    if (glyph) glyph->setColor(tag.color);
-                }
-                globalIndex++;
-                if (globalIndex >= tag.end) break;
-            }
-            if (globalIndex >= tag.end) break;
-        }
+void RichAlertLayer::applyColorTag(std::vector<CCFontSprite*> const& glyphs, ColorTag const& tag) {
+    for (size_t i = tag.start; i < tag.end && i < glyphs.size(); ++i) {
+        if (glyphs[i]) glyphs[i]->setColor(tag.color);
     }
 }
 
-void RichAlertLayer::applyUnderlineTags(MultilineBitmapFont* mbf, std::vector<UnderlineTag> const& tags) {
-    if (auto existing = mbf->getChildByID("underlineLayer")) {
+CCNode* RichAlertLayer::replaceLayer(MultilineBitmapFont* mbf, char const* id) {
+    if (auto existing = mbf->getChildByID(id)) {
         existing->removeFromParentAndCleanup(true);
     }
-    auto underlineLayer = CCNode::create();
-    underlineLayer->setID("underlineLayer");
-    mbf->addChild(underlineLayer);
-
-    for (const auto& tag : tags) {
-        size_t globalIndex = 0;
-        bool foundFirst = false;
-        CCPoint leftWorld, rightWorld;
-        float glyphHeight = 0;
-        CCLabelBMFont* tagLabel = nullptr;
-
-        ccColor4F underlineColor = { 1, 1, 1, 1 };
-
-        for (auto label : CCArrayExt<CCLabelBMFont*>(mbf->getChildren())) {
-            if (!label) continue;
-
-            auto glyphs = CCArrayExt<CCFontSprite*>(label->getChildren());
-            for (auto glyph : glyphs) {
-                if (globalIndex >= tag.start && globalIndex < tag.end) {
-                    if (!glyph) {
-                        globalIndex++;
-                        continue;
-                    }
-
-                    auto pos = glyph->getPosition();
-                    auto size = glyph->getContentSize();
-                    auto worldPos = glyph->getParent()->convertToWorldSpace(pos);
-
-                    float left = worldPos.x - size.width / 2;
-                    float right = worldPos.x + size.width / 2;
-
-                    if (!foundFirst) {
-                        leftWorld = CCPoint(left, worldPos.y);
-                        rightWorld = CCPoint(right, worldPos.y);
-                        glyphHeight = size.height;
-                        tagLabel = label;
-
-                        auto col = glyph->getColor();
-                        underlineColor = {
-                            col.r / 255.f,
-                            col.g / 255.f,
-                            col.b / 255.f,
-                            1.f
-                        };
-
-                        foundFirst = true;
-                    }
-
-                    else {
-                        rightWorld.x = right;
-                    }
-                }
-                globalIndex++;
-                if (globalIndex >= tag.end) break;
-            }
-            if (globalIndex >= tag.end) break;
-        }
-
-        if (foundFirst && tagLabel) {
-            auto underline = CCDrawNode::create();
+    auto layer = CCNode::create();
+    layer->setID(id);
+    mbf->addChild(layer);
+    return layer;
+}
 
-            auto leftLocal = mbf->convertToNodeSpace(leftWorld);
-            auto rightLocal = mbf->convertToNodeSpace(rightWorld);
+void RichAlertLayer::applyCustomTags(MultilineBitmapFont* mbf, std::vector<CCFontSprite*> const& glyphs,
+    size_t customIndex, std::vector<RichTag> const& tags) {
+    auto& registry = RichTagRegistry::get();
+    if (auto& render = registry.handlers(RichTagRegistry::BuiltinCount + customIndex).render)
+        render(this, mbf, glyphs, tags);
+}
 
-            float underlineY = tagLabel->getPositionY();
+void RichAlertLayer::applyUnderlineTag(CCNode* layer, std::vector<CCFontSprite*> const& glyphs, UnderlineTag const& tag) {
+    auto first = firstGlyph(glyphs, tag.start, tag.end);
+    if (!first) return;
 
-            CCPoint verts[4] = {
-                { leftLocal.x - 1.f, underlineY },
-                { rightLocal.x + 1.f, underlineY },
-                { rightLocal.x + 1.f, underlineY - 0.25f },
-                { leftLocal.x - 1.f, underlineY - 0.25f },
-            };
+    auto col = first->getDisplayedColor();
+    Decoration underline;
+    underline.color = { col.r / 255.f, col.g / 255.f, col.b / 255.f, 1.f };
+    underline.extend = 1.f;
 
-            underline->drawPolygon(verts, 4, underlineColor, 0, underlineColor);
-            underlineLayer->addChild(underline);
-        }
-    }
+    addLineDecorations(layer, glyphs, tag.start, tag.end, 0.f, underline);
 }
 
 template<typename T>
@@ -334,276 +596,616 @@ std::vector<T> adjustTagOffsets(std::vector<T> const& tags, size_t offset, size_
 }
 
 
-void RichAlertLayer::applyFontStyleTags(
-    MultilineBitmapFont* mbf,
-    std::vector<BoldTag> const& boldTags,
-    std::vector<ItalicTag> const& italicTags
-) {
-    struct LabelChunk {
-        CCLabelBMFont* label;
-        std::string text;
-        float xOffset;
-        float yPos;
+// Every styled font is generated at several sizes, smallest first. Labels use
+// the smallest one that still covers the size the text is drawn at, scaled up
+// to the layout of the full size font, so small text keeps small atlases.
+std::vector<RichAlertLayer::FontTier> const& RichAlertLayer::fontTiers() {
+    static std::vector<FontTier> tiers = {
+        { 27.f, { "boldChatFont27.fnt"_spr, "italicChatFont27.fnt"_spr, "boldItalicChatFont27.fnt"_spr } },
+        { 40.f, { "boldChatFont40.fnt"_spr, "italicChatFont40.fnt"_spr, "boldItalicChatFont40.fnt"_spr } },
+        { 53.f, { "boldChatFont.fnt"_spr, "italicChatFont.fnt"_spr, "boldItalicChatFont.fnt"_spr } },
     };
+    return tiers;
+}
 
-    std::vector<LabelChunk> chunks;
-    for (auto node : CCArrayExt<CCNode*>(mbf->getChildren())) {
-        if (auto* label = static_cast<CCLabelBMFont*>(node)) {
-            chunks.push_back({ label, label->getString(), label->getPositionX(), label->getPositionY() });
+size_t RichAlertLayer::pickFontTier(float scale) {
+    auto const& tiers = fontTiers();
+    float needed = tiers.back().size * scale;
+    for (size_t i = 0; i < tiers.size(); ++i) {
+        if (tiers[i].size >= needed) return i;
+    }
+    return tiers.size() - 1;
+}
+
+// The atlas of a font as it sits in the texture cache. Only fonts a popup has
+// used are looked up, their config is cached by then, so sizes nobody used are
+// never loaded just to report on them.
+CCTexture2D* RichAlertLayer::fontTexture(char const* file) {
+    if (!s_fontUsers.contains(file)) return nullptr;
+
+    auto config = FNTConfigLoadFile(file);
+    if (!config) return nullptr;
+    return CCTextureCache::sharedTextureCache()->textureForKey(config->getAtlasName());
+}
+
+std::vector<FontTierStats> RichAlertLayer::getFontTierStats() {
+    std::vector<FontTierStats> stats;
+    for (auto const& tier : fontTiers()) {
+        for (auto file : tier.files) {
+            auto users = s_fontUsers.find(file);
+            FontTierStats entry{ file, tier.size, false, 0, users != s_fontUsers.end() ? users->second : 0 };
+            if (auto texture = fontTexture(file)) {
+                entry.loaded = true;
+                entry.bytes = static_cast<size_t>(texture->getPixelsWide()) * texture->getPixelsHigh()
+                    * texture->bitsPerPixelForFormat() / 8;
+            }
+            stats.push_back(entry);
         }
     }
+    return stats;
+}
 
+size_t RichAlertLayer::evictUnusedFontTiers() {
+    size_t evicted = 0;
+    for (auto const& tier : fontTiers()) {
+        for (auto file : tier.files) {
+            if (auto users = s_fontUsers.find(file); users != s_fontUsers.end() && users->second > 0)
+                continue;
+            if (auto texture = fontTexture(file)) {
+                CCTextureCache::sharedTextureCache()->removeTexture(texture);
+                ++evicted;
+            }
+        }
+    }
+
+    // the font configs stay cached, they're shared with every other label in
+    // the game and only the texture is reloaded on next use
+    return evicted;
+}
+
+std::vector<RichAlertLayer::TextLine> RichAlertLayer::collectLines(MultilineBitmapFont* mbf) {
     const float epsilon = 1.0f;
-    std::map<float, std::vector<LabelChunk>> linesMap;
+    std::map<float, std::vector<CCLabelBMFont*>> linesMap;
+
+    for (auto node : CCArrayExt<CCNode*>(mbf->getChildren())) {
+        auto label = typeinfo_cast<CCLabelBMFont*>(node);
+        if (!label) continue;
 
-    for (auto& chunk : chunks) {
         bool inserted = false;
-        for (auto& [lineY, lineChunks] : linesMap) {
-            if (fabs(lineY - chunk.yPos) < epsilon) {
-                lineChunks.push_back(chunk);
+        for (auto& [lineY, lineLabels] : linesMap) {
+            if (fabs(lineY - label->getPositionY()) < epsilon) {
+                lineLabels.push_back(label);
                 inserted = true;
                 break;
             }
         }
-        if (!inserted) linesMap[chunk.yPos] = { chunk };
+        if (!inserted) linesMap[label->getPositionY()] = { label };
     }
 
-    std::vector<std::pair<float, std::vector<LabelChunk>>> lines(linesMap.begin(), linesMap.end());
-    std::sort(lines.begin(), lines.end(), [](auto& a, auto& b) { return a.first > b.first; });
+    std::vector<TextLine> lines;
+    for (auto& [lineY, lineLabels] : linesMap) {
+        std::sort(lineLabels.begin(), lineLabels.end(), [](auto a, auto b) { return a->getPositionX() < b->getPositionX(); });
+        lines.push_back({ lineY, std::move(lineLabels) });
+    }
+    std::sort(lines.begin(), lines.end(), [](auto& a, auto& b) { return a.y > b.y; });
 
-    for (auto& chunk : chunks)
-        chunk.label->removeFromParentAndCleanup(true);
+    return lines;
+}
 
-    float globalOffset = 0;
-    for (auto& [lineY, lineChunks] : lines) {
-        std::sort(lineChunks.begin(), lineChunks.end(), [](auto& a, auto& b) { return a.xOffset < b.xOffset; });
+// Replaces the labels of one line with new labels for each run of glyphs
+// sharing a font style, and on the fast path also a color.
+void RichAlertLayer::relayoutLine(BuildJob& job, size_t lineNumber) {
+    auto& line = job.lines[lineNumber];
+    auto& mbf = job.mbf;
+    auto const& colorMap = job.colorMap;
+    size_t globalOffset = job.glyphOffset;
 
-        std::string lineText;
-        for (auto& chunk : lineChunks) lineText += chunk.text;
-        
-        auto styleMap = buildStyleMap(
-            lineText.size(),
-            adjustTagOffsets(boldTags, globalOffset, lineText.size()),
-            adjustTagOffsets(italicTags, globalOffset, lineText.size())
-        );
+    std::string lineText;
+    for (auto label : line.labels) lineText += label->getString();
 
-        float indentX = lineChunks.empty() ? 0.0f : lineChunks.front().xOffset;
-        float x = 0;
-        size_t i = 0;
+    float indentX = line.labels.empty() ? 0.0f : line.labels.front()->getPositionX();
 
-        while (i < lineText.size()) {
-            FontStyle style = styleMap[i];
-            size_t j = i;
-            while (j < lineText.size() && styleMap[j] == style)
-                ++j;
+    for (auto label : line.labels)
+        label->removeFromParentAndCleanup(true);
+    line.labels.clear();
 
-            std::string segment = lineText.substr(i, j - i);
-            const char* fontFile = "chatFont.fnt";
+    auto lineIndex = buildGlyphIndex(lineText);
+    size_t lineGlyphs = lineIndex.back();
+    if (lineGlyphs == 0) return;
 
-            switch (style) {
-            case Bold:       fontFile = "boldChatFont.fnt"_spr; break;
-            case Italic:     fontFile = "italicChatFont.fnt"_spr; break;
-            case BoldItalic: fontFile = "boldItalicChatFont.fnt"_spr; break;
-            default: break;
-            }
+    auto styleMap = buildStyleMap(
+        lineGlyphs,
+        adjustTagOffsets(job.parsed.boldTags, globalOffset, lineGlyphs),
+        adjustTagOffsets(job.parsed.italicTags, globalOffset, lineGlyphs)
+    );
+
+    // stray newlines map past the last glyph, so they borrow its style
+    auto styleAt = [&](size_t byte) { return styleMap[std::min(lineIndex[byte], lineGlyphs - 1)]; };
+    auto colorAt = [&](size_t byte) {
+        size_t glyph = globalOffset + std::min(lineIndex[byte], lineGlyphs - 1);
+        return glyph < colorMap.size() ? colorMap[glyph] : NoColor;
+    };
 
-            auto lbl = CCLabelBMFont::create(segment.c_str(), fontFile);
-            lbl->setAnchorPoint({ 0, 0 });
-            float posY = lineY;
-            if (style == Bold || style == BoldItalic || style == Italic) posY += 3.5f;
-            lbl->setPosition(x + indentX, posY);
-            mbf->addChild(lbl);
-            x += lbl->getContentSize().width;
-            i = j;
+    float x = 0;
+    size_t i = 0;
+
+    while (i < lineText.size()) {
+        FontStyle style = styleAt(i);
+        uint32_t color = colorAt(i);
+        size_t j = i;
+        while (j < lineText.size() && styleAt(j) == style && colorAt(j) == color)
+            ++j;
+
+        std::string segment = lineText.substr(i, j - i);
+        const char* fontFile = "chatFont.fnt";
+        float fontScale = 1.f;
+
+        if (style != Normal) {
+            auto const& tiers = fontTiers();
+            auto const& tier = tiers[job.fontTier];
+            fontFile = tier.files[style - Bold];
+            fontScale = tiers.back().size / tier.size;
         }
 
-        globalOffset += lineText.size();
+        auto lbl = CCLabelBMFont::create(segment.c_str(), fontFile);
+        if (style != Normal && m_usedFonts.insert(fontFile).second)
+            ++s_fontUsers[fontFile];
+        lbl->setScale(fontScale);
+        lbl->setAnchorPoint({ 0, 0 });
+        float posY = line.y;
+        if (style == Bold || style == BoldItalic || style == Italic) posY += 3.5f;
+        lbl->setPosition(x + indentX, posY);
+        lbl->setTag(static_cast<int>(lineNumber));
+        if (color != NoColor)
+            lbl->setColor(ccc3((color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF));
+        mbf->addChild(lbl);
+        x += lbl->getContentSize().width * fontScale;
+        i = j;
     }
+
+    job.glyphOffset += lineGlyphs;
 }
 
-void RichAlertLayer::applyStrikeTags(MultilineBitmapFont* mbf, std::vector<StrikeTag> const& tags) {
-    if (auto existing = mbf->getChildByID("strikelineLayer")) {
-        existing->removeFromParentAndCleanup(true);
-    }
-    auto strikeLineLayer = CCNode::create();
-    strikeLineLayer->setID("strikelineLayer");
-    mbf->addChild(strikeLineLayer);
-
-    for (const auto& tag : tags) {
-        size_t globalIndex = 0;
-        bool foundFirst = false;
-        CCPoint leftWorld, rightWorld;
-        float glyphHeight = 0;
-        CCLabelBMFont* tagLabel = nullptr;
-
-        ccColor4F strikelineColor = { 1, 1, 1, 1 };
-
-        for (auto label : CCArrayExt<CCLabelBMFont*>(mbf->getChildren())) {
-            if (!label) continue;
-
-            auto glyphs = CCArrayExt<CCFontSprite*>(label->getChildren());
-            for (auto glyph : glyphs) {
-                if (globalIndex >= tag.start && globalIndex < tag.end) {
-                    if (!glyph) {
-                        globalIndex++;
-                        continue;
-                    }
-
-                    auto pos = glyph->getPosition();
-                    auto size = glyph->getContentSize();
-                    auto worldPos = glyph->getParent()->convertToWorldSpace(pos);
-
-                    float left = worldPos.x - size.width / 2;
-                    float right = worldPos.x + size.width / 2;
-
-                    if (!foundFirst) {
-                        leftWorld = CCPoint(left, worldPos.y);
-                        rightWorld = CCPoint(right, worldPos.y);
-                        glyphHeight = size.height;
-                        tagLabel = label;
-
-                        auto col = glyph->getColor();
-                        strikelineColor = {
-                            col.r / 255.f,
-                            col.g / 255.f,
-                            col.b / 255.f,
-                            1.f
-                        };
-
-                        foundFirst = true;
-                    }
-
-                    else {
-                        rightWorld.x = right;
-                    }
-                }
-                globalIndex++;
-                if (globalIndex >= tag.end) break;
-            }
-            if (globalIndex >= tag.end) break;
-        }
+void RichAlertLayer::applyStrikeTag(CCNode* layer, std::vector<CCFontSprite*> const& glyphs, StrikeTag const& tag) {
+    auto first = firstGlyph(glyphs, tag.start, tag.end);
+    if (!first) return;
 
-        if (foundFirst && tagLabel) {
-            auto strikeline = CCDrawNode::create();
+    auto col = first->getDisplayedColor();
+    Decoration strikeline;
+    strikeline.color = { col.r / 255.f, col.g / 255.f, col.b / 255.f, 1.f };
+    strikeline.extend = 1.f;
 
-            auto leftLocal = mbf->convertToNodeSpace(leftWorld);
-            auto rightLocal = mbf->convertToNodeSpace(rightWorld);
+    addLineDecorations(layer, glyphs, tag.start, tag.end, 8.f, strikeline);
+}
 
-            float strikelineY = tagLabel->getPositionY() + 8;
+// The first drawn glyph in [start, end), skipping the holes of characters the font doesn't have.
+CCFontSprite* RichAlertLayer::firstGlyph(std::vector<CCFontSprite*> const& glyphs, size_t start, size_t end) {
+    for (size_t i = start; i < end && i < glyphs.size(); ++i) {
+        if (glyphs[i]) return glyphs[i];
+    }
+    return nullptr;
+}
 
-            CCPoint verts[4] = {
-                { leftLocal.x - 1.f, strikelineY },
-                { rightLocal.x + 1.f, strikelineY },
-                { rightLocal.x + 1.f, strikelineY - 0.25f },
-                { leftLocal.x - 1.f, strikelineY - 0.25f },
-            };
+CCRect RichAlertLayer::glyphRect(CCNode* glyph) {
+    return CCRectApplyAffineTransform(glyph->boundingBox(), glyph->getParent()->nodeToParentTransform());
+}
 
-            strikeline->drawPolygon(verts, 4, strikelineColor, 0, strikelineColor);
-            strikeLineLayer->addChild(strikeline);
+// Adds one decoration per line covered by [start, end), placed relative to the
+// baseline of the line's first label. Every decoration is remembered with its
+// glyph range, so the reveal can grow it glyph by glyph.
+void RichAlertLayer::addLineDecorations(CCNode* layer, std::vector<CCFontSprite*> const& glyphs,
+    size_t start, size_t end, float yOffset, Decoration const& style) {
+    end = std::min(end, glyphs.size());
+
+    size_t i = start;
+    while (i < end) {
+        if (!glyphs[i]) {
+            ++i;
+            continue;
         }
+
+        auto label = glyphs[i]->getParent();
+        size_t j = i + 1;
+        while (j < end && glyphs[j] && glyphs[j]->getParent()->getTag() == label->getTag())
+            ++j;
+
+        Decoration decoration = style;
+        decoration.start = i;
+        decoration.end = j;
+        decoration.left = glyphRect(glyphs[i]).getMinX() - decoration.extend;
+        decoration.right = glyphRect(glyphs[j - 1]).getMaxX() + decoration.extend;
+        decoration.y = label->getPositionY() + yOffset;
+
+        // the fast path draws every decoration into one shared node
+        if (m_renderPath == RenderPath::Fast) {
+            if (!m_mergedDecorations) {
+                m_mergedDecorations = CCDrawNode::create();
+                m_mergedDecorations->setID("decorationLayer");
+                label->getParent()->addChild(m_mergedDecorations);
+            }
+            decoration.node = m_mergedDecorations;
+            drawDecoration(decoration, decoration.right);
+        }
+        else {
+            decoration.node = CCDrawNode::create();
+            drawDecoration(decoration, decoration.right);
+            layer->addChild(decoration.node);
+            m_decorations.push_back(decoration);
+        }
+
+        i = j;
     }
 }
 
-void RichAlertLayer::applyLinkTags(MultilineBitmapFont* mbf, std::vector<LinkTag> const& links) {
-    for (const auto& tag : links) {
-        auto wrapper = CCNode::create();
-        wrapper->setAnchorPoint({ 0, 0 });
+void RichAlertLayer::drawDecoration(Decoration const& decoration, float right) {
+    auto node = decoration.node;
+    auto color = decoration.color;
+    float left = decoration.left;
+    float y = decoration.y;
+
+    if (right <= left) return;
+
+    if (!decoration.dotted) {
+        CCPoint verts[4] = {
+            { left, y },
+            { right, y },
+            { right, y - 0.25f },
+            { left, y - 0.25f },
+        };
+        node->drawPolygon(verts, 4, color, 0, color);
+        return;
+    }
 
-        float minX = FLT_MAX, minY = FLT_MAX;
-        float maxX = FLT_MIN, maxY = FLT_MIN;
+    float dotSpacing = 4.0f;
+    float dotSize = 2.0f;
+
+    for (float x = left; x < right; x += dotSpacing) {
+        CCPoint verts[4] = {
+            { x, y },
+            { x + dotSize, y },
+            { x + dotSize, y - dotSize / 2 },
+            { x, y - dotSize / 2 },
+        };
+        node->drawPolygon(verts, 4, color, 0, color);
+    }
+}
 
-        size_t globalIndex = 0;
+void RichAlertLayer::applyLinkTag(CCNode* layer, std::vector<CCFontSprite*> const& glyphs, LinkTag const& tag,
+    std::vector<LinkSegment>& segments) {
+    Decoration dots;
+    dots.color = ccc4f(0, 1, 1, 180 / 255.f);
+    dots.dotted = true;
+    float dotsDepth = 4.0f;
 
-        for (auto label : CCArrayExt<CCLabelBMFont*>(mbf->getChildren())) {
-            if (!label) continue;
+    size_t link = m_linkUrls.size();
+    m_linkUrls.push_back(tag.url);
+    size_t firstSegment = segments.size();
 
-            auto glyphs = CCArrayExt<CCFontSprite*>(label->getChildren());
-            for (auto glyph : glyphs) {
-                if (globalIndex >= tag.start && globalIndex < tag.end) {
-                    if (glyph) {
-                        auto world = glyph->getParent()->convertToWorldSpace(glyph->getPosition());
+    // a wrapped link gets one segment per line it covers
+    for (size_t i = tag.start; i < tag.end && i < glyphs.size(); ++i) {
+        auto glyph = glyphs[i];
+        if (!glyph) continue;
 
-                        float w = glyph->getContentSize().width * glyph->getScaleX();
-                        float h = glyph->getContentSize().height * glyph->getScaleY();
+        auto label = glyph->getParent();
+        auto rect = glyphRect(glyph);
 
-                        minX = std::min(minX, world.x);
-                        minY = std::min(minY, world.y);
-                        maxX = std::max(maxX, world.x + w);
-                        maxY = std::max(maxY, world.y + h);
+        if (segments.size() == firstSegment || segments.back().line != label->getTag()) {
+            segments.push_back({ rect, link, label->getTag() });
+        }
+        else {
+            auto& bounds = segments.back().rect;
+            float minX = std::min(bounds.getMinX(), rect.getMinX());
+            float minY = std::min(bounds.getMinY(), rect.getMinY());
+            float maxX = std::max(bounds.getMaxX(), rect.getMaxX());
+            float maxY = std::max(bounds.getMaxY(), rect.getMaxY());
+            bounds = CCRect(minX, minY, maxX - minX, maxY - minY);
+        }
 
-                        auto clone = CCSprite::createWithTexture(glyph->getTexture(), glyph->getTextureRect());
-                        clone->setAnchorPoint(glyph->getAnchorPoint());
-                        clone->setScale(glyph->getScale());
-                        clone->setColor(ccc3(0, 255, 255));
-                        clone->setOpacity(glyph->getOpacity());
+        // the fast path already colored the link glyphs with their label
+        if (m_renderPath == RenderPath::Fast) continue;
 
-                        wrapper->addChild(clone);
-                        clone->setPosition(mbf->convertToNodeSpace(world));
+        auto world = label->convertToWorldSpace(glyph->getPosition());
 
-                        glyph->setVisible(false);
-                    }
-                }
-                globalIndex++;
-                if (globalIndex >= tag.end) break;
-            }
-            if (globalIndex >= tag.end) break;
-        }
+        auto clone = CCSprite::createWithTexture(glyph->getTexture(), glyph->getTextureRect());
+        clone->setAnchorPoint(glyph->getAnchorPoint());
+        clone->setScale(glyph->getScale() * label->getScale());
+        clone->setColor(ccc3(0, 255, 255));
+        clone->setOpacity(glyph->getOpacity());
+        clone->setPosition(layer->convertToNodeSpace(world));
+        layer->addChild(clone);
 
-        auto localMin = mbf->convertToNodeSpace({ minX, minY + 55});
-        auto localMax = mbf->convertToNodeSpace({ maxX, maxY + 55});
+        glyph->setVisible(false);
+        if (i < m_revealGlyphs.size()) m_revealGlyphs[i] = clone;
+    }
 
-        auto width = localMax.x - localMin.x;
-        auto height = localMax.y - localMin.y;
+    addLineDecorations(layer, glyphs, tag.start, tag.end, -2.f, dots);
 
-        wrapper->setContentSize({ width, height });
+    // include the dots in the hit area
+    for (size_t s = firstSegment; s < segments.size(); ++s) {
+        segments[s].rect.origin.y -= dotsDepth;
+        segments[s].rect.size.height += dotsDepth;
+    }
+}
 
-        for (auto child : CCArrayExt<CCNode*>(wrapper->getChildren())) {
-            child->setPosition(child->getPosition() - localMin);
-            child->setPositionY(child->getPositionY() + 55);
-        }
+void RichAlertLayer::LinkHitIndex::build(std::vector<LinkSegment> segments) {
+    lines.clear();
+    std::sort(segments.begin(), segments.end(), [](auto const& a, auto const& b) {
+        return a.line != b.line ? a.line < b.line : a.rect.getMinX() < b.rect.getMinX();
+    });
 
-        float dotSpacing = 4.0f;
-        float dotSize = 2.0f;
-        float yOffset = -2.0f; 
+    for (auto const& segment : segments) {
+        if (lines.empty() || lines.back().segments.back().line != segment.line)
+            lines.push_back({ segment.rect.getMinY(), segment.rect.getMaxY(), {} });
+
+        auto& line = lines.back();
+        line.minY = std::min(line.minY, segment.rect.getMinY());
+        line.maxY = std::max(line.maxY, segment.rect.getMaxY());
+        line.segments.push_back(segment);
+    }
 
-        for (float x = 0; x < width; x += dotSpacing) {
-            auto dot = CCSprite::create();
-            dot->setTextureRect({ 0, 0, dotSize, dotSize / 2 });
-            dot->setColor(ccc3(0, 255, 255)); 
-            dot->setOpacity(180);
+    std::sort(lines.begin(), lines.end(), [](auto const& a, auto const& b) { return a.minY < b.minY; });
 
-            dot->setAnchorPoint({ 0, 1 });
-            dot->setPosition({ x - 2, yOffset });
-            wrapper->addChild(dot);
+    // glyph boxes of neighbouring lines can overlap a bit, split the overlap
+    // so the line ranges stay disjoint and can be binary searched
+    for (size_t i = 1; i < lines.size(); ++i) {
+        if (lines[i].minY < lines[i - 1].maxY) {
+            float mid = (lines[i].minY + lines[i - 1].maxY) / 2;
+            lines[i].minY = mid;
+            lines[i - 1].maxY = mid;
         }
+    }
+}
 
-        wrapper->setPosition({ 0, 0 });
+size_t RichAlertLayer::LinkHitIndex::find(CCPoint const& point) const {
+    auto line = std::upper_bound(lines.begin(), lines.end(), point.y,
+        [](float y, Line const& l) { return y < l.minY; });
+    if (line == lines.begin()) return npos;
+    --line;
+    if (point.y > line->maxY) return npos;
 
-        auto menuItem = CCMenuItemLabel::create(wrapper, this, menu_selector(RichAlertLayer::openURL));
-        menuItem->setAnchorPoint({ 0, 0 });
-        menuItem->setPosition(localMin);
-        auto* url = new std::string(tag.url);
-        menuItem->setUserData(url);
+    auto const& segments = line->segments;
+    auto segment = std::upper_bound(segments.begin(), segments.end(), point.x,
+        [](float x, LinkSegment const& s) { return x < s.rect.getMinX(); });
+    if (segment == segments.begin()) return npos;
+    --segment;
 
-        menuItem->setAnchorPoint({ 0.5f, 0.5f });
+    return point.x <= segment->rect.getMaxX() ? segment->link : npos;
+}
 
-        auto size = menuItem->getContentSize();
-        menuItem->setPosition(menuItem->getPosition() + ccp(size.width * 0.5f, size.height * 0.5f));
+size_t RichAlertLayer::findLinkAt(CCTouch* touch) const {
+    if (!m_linkArea) return LinkHitIndex::npos;
 
-        m_buttonMenu->addChild(menuItem);
+    // scrolled text is clipped to the scrolling layer, links outside it aren't visible
+    if (m_scrollingLayer) {
+        auto local = m_scrollingLayer->convertTouchToNodeSpace(touch);
+        if (!CCRect({ 0, 0 }, m_scrollingLayer->getContentSize()).containsPoint(local))
+            return LinkHitIndex::npos;
     }
+
+    return m_linkIndex.find(m_linkArea->convertTouchToNodeSpace(touch));
 }
 
 void RichAlertLayer::openURL(CCObject* sender) {
-    if (auto item = static_cast<CCMenuItemLabel*>(sender)) {
-        if (auto url = static_cast<std::string*>(item->getUserData())) {
+    if (auto node = typeinfo_cast<CCNode*>(sender)) {
+        if (auto url = static_cast<std::string*>(node->getUserData())) {
             web::openLinkInBrowser(*url);
         }
     }
 }
 
+bool RichAlertLayer::ccTouchBegan(CCTouch* touch, CCEvent* event) {
+    m_touchedLink = findLinkAt(touch);
+    return FLAlertLayer::ccTouchBegan(touch, event);
+}
+
+void RichAlertLayer::ccTouchMoved(CCTouch* touch, CCEvent* event) {
+    FLAlertLayer::ccTouchMoved(touch, event);
+
+    // a drag scrolls the text along with the finger, so it may still end on the
+    // same link and mustn't open it
+    const float dragThreshold = 5.f;
+    if (ccpDistance(touch->getLocation(), touch->getStartLocation()) > dragThreshold)
+        m_touchedLink = LinkHitIndex::npos;
+}
+
+void RichAlertLayer::ccTouchCancelled(CCTouch* touch, CCEvent* event) {
+    FLAlertLayer::ccTouchCancelled(touch, event);
+    m_touchedLink = LinkHitIndex::npos;
+}
+
+void RichAlertLayer::ccTouchEnded(CCTouch* touch, CCEvent* event) {
+    FLAlertLayer::ccTouchEnded(touch, event);
+
+    auto link = findLinkAt(touch);
+    if (link != LinkHitIndex::npos && link == m_touchedLink)
+        web::openLinkInBrowser(m_linkUrls[link]);
+    m_touchedLink = LinkHitIndex::npos;
+}
+
+// Renders the styled text, including the link visuals, into one texture. The
+// render texture is positioned in world space, so the text area is visited with
+// its parent's world transform applied on top of the texture's projection.
+bool RichAlertLayer::bakeTextArea(MultilineBitmapFont* mbf, BakedText& baked) {
+    const float padding = 2.f;
+
+    float minX = FLT_MAX, minY = FLT_MAX;
+    float maxX = -FLT_MAX, maxY = -FLT_MAX;
+    auto include = [&](CCRect const& rect) {
+        minX = std::min(minX, rect.getMinX() - padding);
+        minY = std::min(minY, rect.getMinY() - padding);
+        maxX = std::max(maxX, rect.getMaxX() + padding);
+        maxY = std::max(maxY, rect.getMaxY() + padding);
+    };
+
+    auto mbfToWorld = mbf->nodeToWorldTransform();
+    for (auto node : CCArrayExt<CCNode*>(mbf->getChildren())) {
+        if (auto label = typeinfo_cast<CCLabelBMFont*>(node))
+            include(CCRectApplyAffineTransform(label->boundingBox(), mbfToWorld));
+    }
+    for (auto const& segment : m_linkSegments)
+        include(CCRectApplyAffineTransform(segment.rect, mbfToWorld));
+
+    if (minX >= maxX || minY >= maxY) return false;
+
+    int width = static_cast<int>(std::ceil(maxX - minX));
+    int height = static_cast<int>(std::ceil(maxY - minY));
+
+    // a long scrolling body can be taller than the GPU allows, keep the live nodes then
+    int maxPixels = CCConfiguration::sharedConfiguration()->getMaxTextureSize();
+    float contentScale = CC_CONTENT_SCALE_FACTOR();
+    if (width * contentScale > maxPixels || height * contentScale > maxPixels) {
+        log::debug("Text area is {}x{} pixels, too big to cache", width * contentScale, height * contentScale);
+        return false;
+    }
+
+    auto rt = CCRenderTexture::create(width, height);
+    if (!rt) return false;
+
+    auto t = mbf->getParent()->nodeToWorldTransform();
+    kmMat4 parentToWorld;
+    kmMat4Identity(&parentToWorld);
+    parentToWorld.mat[0] = t.a;
+    parentToWorld.mat[1] = t.b;
+    parentToWorld.mat[4] = t.c;
+    parentToWorld.mat[5] = t.d;
+    parentToWorld.mat[12] = t.tx;
+    parentToWorld.mat[13] = t.ty;
+
+    rt->beginWithClear(0, 0, 0, 0);
+    kmGLPushMatrix();
+    kmGLTranslatef(-minX, -minY, 0);
+    kmGLMultMatrix(&parentToWorld);
+    mbf->visit();
+    kmGLPopMatrix();
+    rt->end();
+
+    baked.texture = rt->getSprite()->getTexture();
+    baked.origin = mbf->convertToNodeSpace({ minX, minY });
+    baked.scale = mbfToWorld.a != 0 ? 1.f / mbfToWorld.a : 1.f;
+    baked.linkUrls = m_linkUrls;
+    baked.linkSegments = m_linkSegments;
+
+    return true;
+}
+
+void RichAlertLayer::useBakedText(MultilineBitmapFont* mbf, BakedText const& baked) {
+    mbf->removeAllChildrenWithCleanup(true);
+    releaseFonts();
+    m_revealGlyphs.clear();
+    m_decorations.clear();
+    m_mergedDecorations = nullptr;
+
+    auto sprite = CCSprite::createWithTexture(baked.texture);
+    sprite->setFlipY(true);
+    sprite->setBlendFunc({ GL_ONE, GL_ONE_MINUS_SRC_ALPHA });
+    sprite->setAnchorPoint({ 0, 0 });
+    sprite->setScale(baked.scale);
+    sprite->setPosition(baked.origin);
+    sprite->setID("baked-text");
+    mbf->addChild(sprite);
+
+    // the link areas are kept, so links stay clickable on the baked text
+    m_linkArea = mbf;
+    m_linkUrls = baked.linkUrls;
+    m_linkSegments = baked.linkSegments;
+    m_linkIndex.build(m_linkSegments);
+}
+
+void RichAlertLayer::startReveal(float glyphsPerSecond, std::function<void()> onComplete) {
+    // also catches NaN, which would never finish either
+    if (!(glyphsPerSecond > 0)) {
+        log::warn("Reveal speed has to be positive but is {}, showing the text right away", glyphsPerSecond);
+        m_onRevealComplete = std::move(onComplete);
+        // with nothing revealing, the pending case of finishReveal just runs the callback
+        if (!m_isRevealing) m_revealPending = true;
+        finishReveal();
+        return;
+    }
+
+    m_revealSpeed = glyphsPerSecond;
+    m_revealProgress = 0;
+    m_revealed = 0;
+    m_onRevealComplete = std::move(onComplete);
+
+    // the glyphs don't exist yet, so the reveal starts once the build is done
+    if (m_buildJob) {
+        m_revealPending = true;
+        return;
+    }
+
+    for (auto node : m_revealGlyphs) {
+        if (node) node->setVisible(false);
+    }
+
+    std::sort(m_decorations.begin(), m_decorations.end(), [](auto const& a, auto const& b) { return a.start < b.start; });
+    for (auto const& decoration : m_decorations)
+        decoration.node->clear();
+    if (m_mergedDecorations) m_mergedDecorations->setVisible(false);
+    m_nextDecoration = 0;
+    m_growingDecorations.clear();
+
+    m_isRevealing = true;
+    this->schedule(schedule_selector(RichAlertLayer::updateReveal));
+    revealUpTo(0);
+}
+
+void RichAlertLayer::finishReveal() {
+    if (m_isRevealing) {
+        revealUpTo(m_revealGlyphs.size());
+        return;
+    }
 
+    // a reveal still waiting on the build never hid anything, so it is done already
+    if (!m_revealPending) return;
+    m_revealPending = false;
+    if (auto onComplete = std::move(m_onRevealComplete)) {
+        m_onRevealComplete = nullptr;
+        onComplete();
+    }
+}
 
+void RichAlertLayer::updateReveal(float dt) {
+    m_revealProgress += dt * m_revealSpeed;
+    revealUpTo(std::min(static_cast<size_t>(m_revealProgress), m_revealGlyphs.size()));
+}
+
+// Only the glyphs in [m_revealed, target) are touched, along with the
+// decorations that overlap them, so a tick never walks the whole document.
+void RichAlertLayer::revealUpTo(size_t target) {
+    if (!m_isRevealing) return;
+    if (target <= m_revealed && target < m_revealGlyphs.size()) return;
+
+    for (size_t i = m_revealed; i < target; ++i) {
+        if (m_revealGlyphs[i]) m_revealGlyphs[i]->setVisible(true);
+    }
+
+    while (m_nextDecoration < m_decorations.size() && m_decorations[m_nextDecoration].start < target)
+        m_growingDecorations.push_back(m_nextDecoration++);
+
+    std::erase_if(m_growingDecorations, [&](size_t index) {
+        auto const& decoration = m_decorations[index];
+        decoration.node->clear();
+        if (target >= decoration.end) {
+            drawDecoration(decoration, decoration.right);
+            return true;
+        }
+        if (auto last = m_revealGlyphs[target - 1])
+            drawDecoration(decoration, glyphRect(last).getMaxX() + decoration.extend);
+        return false;
+    });
+
+    m_revealed = target;
+
+    if (m_revealed >= m_revealGlyphs.size()) {
+        this->unschedule(schedule_selector(RichAlertLayer::updateReveal));
+        m_isRevealing = false;
+        if (m_mergedDecorations) m_mergedDecorations->setVisible(true);
+        if (auto onComplete = std::move(m_onRevealComplete)) {
+            m_onRevealComplete = nullptr;
+            onComplete();
+        }
+    }
+}
 
 void RichAlertLayer::setButtonBGColor(ButtonId btn, ButtonColors col) {
     auto file = "GJ_button_01.png";
@@ -679,9 +1281,25 @@ void RichAlertLayer::addInfoButton(RichAlertLayer* popup, InfoPosition pos, floa
     m_buttonMenu->addChild(infoBtn);
 }
 
+void RichAlertLayer::releaseFonts() {
+    for (auto const& file : m_usedFonts)
+        --s_fontUsers[file];
+    m_usedFonts.clear();
+}
+
 RichAlertLayer::~RichAlertLayer() {
+    releaseFonts();
     if (m_popup) {
         m_popup->release();
         m_popup = nullptr;
     }
 }
+
+// Baked textures lose their contents with the GL context, and unlike the render
+// texture they came from they can't restore them, so they're dropped on resume.
+class $modify(AppDelegate) {
+    void applicationWillEnterForeground() {
+        AppDelegate::applicationWillEnterForeground();
+        RichAlertLayer::clearTextCache();
+    }
+};
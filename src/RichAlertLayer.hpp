@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Geode/Geode.hpp>
+#include "RichTagRegistry.hpp"
 
 using namespace geode::prelude;
 
@@ -27,6 +28,19 @@ enum class ButtonColors {
 
 enum FontStyle { Normal, Bold, Italic, BoldItalic };
 
+enum class RenderPath {
+    Full,
+    Fast
+};
+
+struct FontTierStats {
+    std::string font;
+    float size;
+    bool loaded;
+    size_t bytes;
+    size_t users;
+};
+
 class RichAlertLayer : public FLAlertLayer {
 private:
     ~RichAlertLayer();
@@ -72,20 +86,170 @@ private:
         std::vector<ItalicTag> italicTags;
         std::vector<StrikeTag> strikeTags;
         std::vector<LinkTag> links;
+        std::vector<std::vector<RichTag>> customTags;
+        size_t glyphCount = 0;
+    };
+
+    struct LinkSegment {
+        CCRect rect;
+        size_t link;
+        int line;
+    };
+
+    // Link hit areas grouped into lines sorted by height, with the segments of
+    // each line sorted by x, so a touch resolves with two binary searches.
+    struct LinkHitIndex {
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        struct Line {
+            float minY;
+            float maxY;
+            std::vector<LinkSegment> segments;
+        };
+
+        std::vector<Line> lines;
+
+        void build(std::vector<LinkSegment> segments);
+        size_t find(CCPoint const& point) const;
+    };
+
+    struct BakedText {
+        std::string text;
+        geode::Ref<CCTexture2D> texture;
+        CCPoint origin;
+        float scale;
+        std::vector<std::string> linkUrls;
+        std::vector<LinkSegment> linkSegments;
+        uint64_t lastUse = 0;
+    };
+
+    // An underline, strikethrough or link underline on a single line. The glyph
+    // range lets the reveal draw it only up to the last revealed glyph.
+    struct Decoration {
+        CCDrawNode* node = nullptr;
+        size_t start = 0;
+        size_t end = 0;
+        float left = 0;
+        float right = 0;
+        float y = 0;
+        float extend = 0;
+        bool dotted = false;
+        ccColor4F color = { 1, 1, 1, 1 };
+    };
+
+    struct TextLine {
+        float y;
+        std::vector<CCLabelBMFont*> labels;
+    };
+
+    enum class BuildStage {
+        Relayout,
+        Glyphs,
+        Links,
+        Colors,
+        Underlines,
+        Strikes,
+        Custom,
+        Done
+    };
+
+    // Everything needed to resume styling the text area where the last step
+    // stopped, so the work can be spread over several frames.
+    struct BuildJob {
+        ParsedText parsed;
+        MultilineBitmapFont* mbf = nullptr;
+        std::string cacheKey;
+        std::vector<TextLine> lines;
+        std::vector<uint32_t> colorMap;
+        std::vector<CCFontSprite*> glyphs;
+        std::vector<LinkSegment> linkSegments;
+        CCNode* linkLayer = nullptr;
+        CCNode* underlineLayer = nullptr;
+        CCNode* strikeLayer = nullptr;
+        BuildStage stage = BuildStage::Relayout;
+        size_t cursor = 0;
+        size_t glyphOffset = 0;
+        size_t fontTier = 0;
     };
 
+    struct FontTier {
+        float size;
+        char const* files[3];
+    };
 
+    static constexpr uint32_t NoColor = UINT32_MAX;
+
+    inline static std::unordered_map<std::string, BakedText> s_bakedTexts;
+    inline static size_t s_textCacheLimit = 8;
+    inline static uint64_t s_bakeClock = 0;
+    inline static size_t s_fastPathGlyphs = 4000;
+    inline static size_t s_fastPathSpans = 500;
+    inline static size_t s_fastPathCount = 0;
+    inline static std::map<std::string, size_t> s_fontUsers;
+    RenderPath m_renderPath = RenderPath::Full;
+
+    std::unique_ptr<BuildJob> m_buildJob;
+    bool m_sliced = false;
+    float m_frameBudget = 0.004f;
+    std::function<void()> m_onBuildComplete;
+    bool m_revealPending = false;
+    CCDrawNode* m_mergedDecorations = nullptr;
+    bool m_cacheTexture = false;
+    std::set<std::string> m_usedFonts;
+
+    CCNode* m_linkArea = nullptr;
+    std::vector<std::string> m_linkUrls;
+    std::vector<LinkSegment> m_linkSegments;
+    LinkHitIndex m_linkIndex;
+    size_t m_touchedLink = LinkHitIndex::npos;
+
+    std::vector<CCNode*> m_revealGlyphs;
+    std::vector<Decoration> m_decorations;
+    std::vector<size_t> m_growingDecorations;
+    size_t m_nextDecoration = 0;
+    size_t m_revealed = 0;
+    float m_revealProgress = 0;
+    float m_revealSpeed = 0;
+    bool m_isRevealing = false;
+    std::function<void()> m_onRevealComplete;
+
+    static bool parseHexColor(std::string_view hex, ccColor3B& out);
     static ParsedText parseRichText(std::string const& raw);
-    void applyColorTags(MultilineBitmapFont* mbf, std::vector<ColorTag> const& tags);
-    void applyUnderlineTags(MultilineBitmapFont* mbf, std::vector<UnderlineTag> const& tags);
-    void applyFontStyleTags(MultilineBitmapFont* mbf,
-        std::vector<BoldTag> const& boldTags,
-        std::vector<ItalicTag> const& italicTags);
-    void applyStrikeTags(MultilineBitmapFont* mbf, std::vector<StrikeTag> const& tags);
-    void applyLinkTags(
-        MultilineBitmapFont* mbf,
-        std::vector<LinkTag> const& links
+    static std::vector<size_t> buildGlyphIndex(std::string_view text);
+    static void remapToGlyphs(ParsedText& parsed);
+    static std::vector<uint32_t> buildColorMap(ParsedText const& parsed);
+    static std::vector<FontTier> const& fontTiers();
+    static size_t pickFontTier(float scale);
+    static CCTexture2D* fontTexture(char const* file);
+    void releaseFonts();
+    static std::vector<TextLine> collectLines(MultilineBitmapFont* mbf);
+    static CCNode* replaceLayer(MultilineBitmapFont* mbf, char const* id);
+    bool buildStep(BuildJob& job);
+    void updateBuild(float dt);
+    void finishBuild();
+    void relayoutLine(BuildJob& job, size_t lineNumber);
+    void applyColorTag(std::vector<CCFontSprite*> const& glyphs, ColorTag const& tag);
+    void applyUnderlineTag(CCNode* layer, std::vector<CCFontSprite*> const& glyphs, UnderlineTag const& tag);
+    void applyStrikeTag(CCNode* layer, std::vector<CCFontSprite*> const& glyphs, StrikeTag const& tag);
+    void applyCustomTags(MultilineBitmapFont* mbf, std::vector<CCFontSprite*> const& glyphs,
+        size_t customIndex, std::vector<RichTag> const& tags);
+    void applyLinkTag(
+        CCNode* layer,
+        std::vector<CCFontSprite*> const& glyphs,
+        LinkTag const& tag,
+        std::vector<LinkSegment>& segments
     );
+    size_t findLinkAt(CCTouch* touch) const;
+    static CCFontSprite* firstGlyph(std::vector<CCFontSprite*> const& glyphs, size_t start, size_t end);
+    static CCRect glyphRect(CCNode* glyph);
+    void addLineDecorations(CCNode* layer, std::vector<CCFontSprite*> const& glyphs,
+        size_t start, size_t end, float yOffset, Decoration const& style);
+    void drawDecoration(Decoration const& decoration, float right);
+    void updateReveal(float dt);
+    void revealUpTo(size_t target);
+    static void trimTextCache();
+    bool bakeTextArea(MultilineBitmapFont* mbf, BakedText& baked);
+    void useBakedText(MultilineBitmapFont* mbf, BakedText const& baked);
 
 
 public:
@@ -100,10 +264,94 @@ public:
         float textScale = 1.f
     );
 
+    // Same as create, but renders the finished text area into a single texture
+    // that is reused by later popups with the same content. Only use this for
+    // text that doesn't change after creation. A cache hit skips parsing and
+    // styling, but FLAlertLayer still lays out the plain text once to size the
+    // popup before it is swapped for the texture.
+    static RichAlertLayer* createCached(
+        std::string const& title,
+        std::string const& desc,
+        std::string const& btn1,
+        std::string const& btn2 = "",
+        float width = 300.f,
+        bool scroll = false,
+        float height = 140.f,
+        float textScale = 1.f
+    );
+
+    // Same as create, but styles the text over several frames instead of all at
+    // once in init, showing each line as soon as it is done. Use setFrameBudget
+    // and setOnBuildComplete right after creating it.
+    static RichAlertLayer* createSliced(
+        std::string const& title,
+        std::string const& desc,
+        std::string const& btn1,
+        std::string const& btn2 = "",
+        float width = 300.f,
+        bool scroll = false,
+        float height = 140.f,
+        float textScale = 1.f
+    );
+
+    // Frees all cached textures. This also happens when the game returns to the
+    // foreground, since the textures can't be restored after a GL context loss.
+    static void clearTextCache();
+
+    // How many texts createCached keeps at most. The least recently used one is
+    // dropped first. Defaults to 8.
+    static void setTextCacheLimit(size_t count);
+
+    // Descriptions with more glyphs or tag spans than this are built on the fast
+    // path: colors are set per label run, links skip the glyph clones and all
+    // decorations share one draw node. That node can't grow glyph by glyph, so
+    // during a reveal the decorations stay hidden and appear once it finishes.
+    static void setFastPathThresholds(size_t maxGlyphs, size_t maxSpans);
+
+    // How many popups were built on the fast path so far.
+    static size_t getFastPathCount() {
+        return s_fastPathCount;
+    }
+
+    RenderPath getRenderPath() const {
+        return m_renderPath;
+    }
+
+    // Texture memory of every size of the bold and italic fonts, and how many
+    // popups use each. Sizes no popup has used yet report as not loaded.
+    static std::vector<FontTierStats> getFontTierStats();
+
+    // Frees the textures of the font sizes no popup is using right now. Returns
+    // how many were freed.
+    static size_t evictUnusedFontTiers();
+
+    // Time in seconds the sliced build may spend per frame. Defaults to 4ms.
+    void setFrameBudget(float seconds);
+
+    // Runs once the text is fully styled, or right away if it already is. It is
+    // not called if the popup is closed before the build finishes.
+    void setOnBuildComplete(std::function<void()> onComplete);
+
+    bool isBuilding() const {
+        return m_buildJob != nullptr;
+    }
+
     void show();
 
     void setButtonBGColor(ButtonId btn, ButtonColors color);
 
+    // Hides the description and types it out again at the given speed. Only the
+    // newly revealed glyphs are touched each frame. Popups made with createCached
+    // have no separate glyphs and finish right away, and so does a speed that
+    // isn't positive.
+    void startReveal(float glyphsPerSecond, std::function<void()> onComplete = nullptr);
+    void finishReveal();
+
+    // Also true while a reveal waits for a createSliced build to finish.
+    bool isRevealing() const {
+        return m_isRevealing || m_revealPending;
+    }
+
     void addInfoButton(RichAlertLayer* popup, InfoPosition pos, float scale = 1.f, CCPoint offset = { 0,0 });
 
     void setPopup(RichAlertLayer* popup) {
@@ -116,8 +364,15 @@ public:
         }
     }
 
+    // Links no longer use menu items, this is kept for callers that bound it to
+    // their own. Opens the std::string* url stored in the sender's user data.
     void openURL(CCObject* sender);
 
+    bool ccTouchBegan(CCTouch* touch, CCEvent* event) override;
+    void ccTouchMoved(CCTouch* touch, CCEvent* event) override;
+    void ccTouchEnded(CCTouch* touch, CCEvent* event) override;
+    void ccTouchCancelled(CCTouch* touch, CCEvent* event) override;
+
     static std::vector<FontStyle> buildStyleMap(
         size_t textLen,
         std::vector<BoldTag>   const& boldTags,
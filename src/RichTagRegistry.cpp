@@ -0,0 +1,74 @@
+#include "RichTagRegistry.hpp"
+
+RichTagRegistry& RichTagRegistry::get() {
+    static RichTagRegistry registry;
+    return registry;
+}
+
+RichTagRegistry::RichTagRegistry() {
+    m_slots.resize(16);
+
+    // order has to match BuiltinTag
+    addTag("col", {});
+    addTag("u", {});
+    addTag("b", {});
+    addTag("i", {});
+    addTag("s", {});
+    addTag("link", {});
+}
+
+uint64_t RichTagRegistry::hashName(std::string_view name) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : name) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void RichTagRegistry::insert(uint64_t hash, uint32_t id) {
+    size_t mask = m_slots.size() - 1;
+    size_t i = hash & mask;
+    while (m_slots[i].id != npos)
+        i = (i + 1) & mask;
+    m_slots[i] = { hash, id };
+}
+
+void RichTagRegistry::addTag(std::string const& name, RichTagHandlers handlers) {
+    if ((m_names.size() + 1) * 2 > m_slots.size()) {
+        m_slots.assign(m_slots.size() * 2, Slot{});
+        for (uint32_t id = 0; id < m_names.size(); ++id)
+            insert(hashName(m_names[id]), id);
+    }
+
+    auto id = static_cast<uint32_t>(m_names.size());
+    m_names.push_back(name);
+    m_handlers.push_back(std::move(handlers));
+    insert(hashName(name), id);
+}
+
+bool RichTagRegistry::registerTag(std::string const& name, RichTagHandlers handlers) {
+    if (name.empty() || name.find_first_of("/=<>") != std::string::npos) {
+        log::warn("Can't register rich tag \"{}\", invalid name", name);
+        return false;
+    }
+    if (find(name) != npos) {
+        log::warn("Can't register rich tag \"{}\", name is already taken", name);
+        return false;
+    }
+
+    addTag(name, std::move(handlers));
+    return true;
+}
+
+uint32_t RichTagRegistry::find(std::string_view name) const {
+    auto hash = hashName(name);
+    size_t mask = m_slots.size() - 1;
+
+    for (size_t i = hash & mask; m_slots[i].id != npos; i = (i + 1) & mask) {
+        auto const& slot = m_slots[i];
+        if (slot.hash == hash && m_names[slot.id] == name)
+            return slot.id;
+    }
+    return npos;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Geode/Geode.hpp>
+
+using namespace geode::prelude;
+
+class RichAlertLayer;
+
+struct RichTag {
+    size_t start;
+    size_t end;
+    std::string arg;
+};
+
+struct RichTagHandlers {
+    // Called for the opening tag, e.g. "<icon=star>" passes "star". Text appended to
+    // `text` becomes part of the description, so icons can insert a placeholder.
+    // Returning false keeps the tag in the description as literal text.
+    std::function<bool(std::string_view arg, std::string& text)> onOpen;
+
+    // Called for the closing tag once the span is known.
+    std::function<void(RichTag const& tag, std::string& text)> onClose;
+
+    // Runs after the built-in passes with every span of this tag. Offsets are glyph
+    // indices into `glyphs`.
+    std::function<void(
+        RichAlertLayer* layer,
+        MultilineBitmapFont* mbf,
+        std::vector<CCFontSprite*> const& glyphs,
+        std::vector<RichTag> const& tags
+    )> render;
+};
+
+class RichTagRegistry {
+public:
+    enum BuiltinTag : uint32_t {
+        Color,
+        Underline,
+        Bold,
+        Italic,
+        Strike,
+        Link,
+        BuiltinCount
+    };
+
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    static RichTagRegistry& get();
+
+    // Registers a custom tag by name, used as "<name>" or "<name=arg>" and closed with
+    // "</name>". Fails if the name is taken or can't be written inside a tag.
+    bool registerTag(std::string const& name, RichTagHandlers handlers);
+
+    uint32_t find(std::string_view name) const;
+
+    RichTagHandlers const& handlers(uint32_t id) const {
+        return m_handlers[id];
+    }
+
+    size_t size() const {
+        return m_names.size();
+    }
+
+private:
+    RichTagRegistry();
+
+    // Open addressing table keyed by the name hash. The capacity is always a power of two
+    // and kept at most half full, so a lookup is one hash and usually one compare.
+    struct Slot {
+        uint64_t hash = 0;
+        uint32_t id = npos;
+    };
+
+    std::vector<Slot> m_slots;
+    std::vector<std::string> m_names;
+    std::vector<RichTagHandlers> m_handlers;
+
+    static uint64_t hashName(std::string_view name);
+    void insert(uint64_t hash, uint32_t id);
+    void addTag(std::string const& name, RichTagHandlers handlers);
+};